@@ -1,13 +1,28 @@
+#define _GNU_SOURCE // sched_setaffinity and the CPU_* macros
 #include <unistd.h>
 #include <sys/wait.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <termios.h>            //termios, TCSANOW, ECHO, ICANON
 #include <string.h>
+#include <ctype.h>
+#include <strings.h>
 #include <stdbool.h>
 #include <errno.h>
 #include <fcntl.h> 
 #include <limits.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <linux/mempolicy.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <signal.h>
 const char * sysname = "seashell";
 
 enum return_codes {
@@ -23,7 +38,134 @@ struct command_t {
 	char **args;
 	char *redirects[3]; // in/out redirection
 	struct command_t *next; // for piping
+	struct exec_policy_t *policy; // set by pin, numa, limit and nice prefixes
 };
+/**
+ * A growable byte buffer, used to collect command output for $(...)
+ */
+struct capture_t {
+	char *data;
+	size_t len, size;
+};
+void capture_append(struct capture_t *capture, const char *data, size_t len)
+{
+	if (capture->len + len > capture->size)
+	{
+		capture->size = (capture->len + len) * 2;
+		capture->data = realloc(capture->data, capture->size);
+	}
+	memcpy(capture->data + capture->len, data, len);
+	capture->len += len;
+}
+#define OUT_BUFSIZE (1 << 16)
+/**
+ * Output buffer shared by all builtins. It goes to whatever stdout is at
+ * flush time, with writev when it fills up, before the prompt is shown or
+ * a child is started, and after each newline when stdout is a terminal.
+ */
+struct out_buffer_t {
+	char buf[OUT_BUFSIZE];
+	size_t len;
+	bool tty; // stdout was a terminal when the buffer was started
+	struct capture_t *capture; // collect the output here instead of writing it
+};
+struct out_buffer_t out;
+/**
+ * Write all of an io vector to stdout, resuming after partial writes
+ * @param  iov     [description]
+ * @param  count   [description]
+ */
+void out_writev(struct iovec *iov, int count)
+{
+	if (out.capture)
+	{
+		for (int i = 0; i < count; ++i)
+			capture_append(out.capture, iov[i].iov_base, iov[i].iov_len);
+		return;
+	}
+	fflush(stdout); // anything printed with stdio goes first
+	while (count > 0)
+	{
+		ssize_t n = writev(STDOUT_FILENO, iov, count);
+		if (n == -1)
+		{
+			if (errno == EINTR) continue;
+			return; // nowhere to report it, drop the output
+		}
+		while (count > 0 && (size_t)n >= iov->iov_len)
+		{
+			n -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+}
+void out_flush()
+{
+	struct iovec iov = { out.buf, out.len };
+	if (out.len > 0)
+		out_writev(&iov, 1);
+	out.len = 0;
+}
+/**
+ * Account for len new bytes at the end of the buffer
+ */
+void out_commit(size_t len)
+{
+	if (out.len == 0)
+		out.tty = !out.capture && isatty(STDOUT_FILENO);
+	out.len += len;
+	if (out.tty && memchr(out.buf + out.len - len, '\n', len) != NULL)
+		out_flush();
+}
+void out_write(const char *data, size_t len)
+{
+	if (out.len + len > OUT_BUFSIZE)
+	{
+		if (len >= OUT_BUFSIZE) // too big to buffer, send it along with what is pending
+		{
+			struct iovec iov[2] = { { out.buf, out.len }, { (void *)data, len } };
+			out_writev(iov, 2);
+			out.len = 0;
+			return;
+		}
+		out_flush();
+	}
+	memcpy(out.buf + out.len, data, len);
+	out_commit(len);
+}
+void out_puts(const char *s)
+{
+	out_write(s, strlen(s));
+}
+/**
+ * printf into the output buffer, formatting in place when it fits
+ * @param  format  [description]
+ */
+void out_printf(const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	int n = vsnprintf(out.buf + out.len, OUT_BUFSIZE - out.len, format, ap);
+	va_end(ap);
+	if (n < 0) return;
+	if (out.len + n < OUT_BUFSIZE)
+	{
+		out_commit(n);
+		return;
+	}
+	char *s = malloc(n + 1);
+	va_start(ap, format);
+	vsnprintf(s, n + 1, format, ap);
+	va_end(ap);
+	out_write(s, n);
+	free(s);
+}
 /**
  * Prints a command struct
  * @param struct command_t *
@@ -55,12 +197,9 @@ void print_command(struct command_t * command)
  */
 int free_command(struct command_t *command)
 {
-	if (command->arg_count)
-	{
-		for (int i = 0; i < command->arg_count; ++i)
-			free(command->args[i]);
-		free(command->args);
-	}
+	for (int i = 0; i < command->arg_count; ++i)
+		free(command->args[i]);
+	free(command->args);
 	for (int i = 0; i < 3; ++i)
 		if (command->redirects[i])
 			free(command->redirects[i]);
@@ -82,9 +221,523 @@ int show_prompt()
 	char cwd[1024], hostname[1024];
 	gethostname(hostname, sizeof(hostname));
 	getcwd(cwd, sizeof(cwd));
+	out_flush(); // builtin output goes before the prompt
 	printf("%s@%s:%s %s$ ", getenv("USER"), hostname, cwd, sysname);
 	return 0;
 }
+#define GETDENTS_BUFSIZE (1 << 17) // bytes requested per getdents64()
+#define DIR_CACHE_BUCKETS 1024
+/**
+ * Entry layout returned by the getdents64 system call
+ */
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+/**
+ * A directory read while expanding the globs of one command line.
+ * All patterns on the line share these, so every directory is read once.
+ */
+struct dir_listing_t {
+	char *path;
+	char *names; // entry names, each one null terminated
+	size_t *offsets; // start of each name in names
+	unsigned char *types; // d_type of each entry
+	size_t count;
+	struct dir_listing_t *next; // hash chain
+};
+struct dir_listing_t *dir_cache[DIR_CACHE_BUCKETS];
+/**
+ * A growable list of words produced by brace and glob expansion
+ */
+struct word_list_t {
+	char **words;
+	size_t count, size;
+};
+void word_list_add(struct word_list_t *list, char *word)
+{
+	if (list->count == list->size)
+	{
+		list->size = list->size ? list->size * 2 : 16;
+		list->words = realloc(list->words, sizeof(char *) * list->size);
+	}
+	list->words[list->count++] = word;
+}
+unsigned int path_hash(const char *path)
+{
+	unsigned int h = 2166136261u; // FNV-1a
+	while (*path)
+		h = (h ^ (unsigned char)*path++) * 16777619u;
+	return h % DIR_CACHE_BUCKETS;
+}
+/**
+ * Get the entries of a directory, reading it with large getdents64 calls
+ * the first time it is needed on the current line
+ * @param  path    [description]
+ * @return         the listing, empty if the directory cannot be read
+ */
+struct dir_listing_t *dir_list(const char *path)
+{
+	static char dents[GETDENTS_BUFSIZE] __attribute__((aligned(8)));
+	unsigned int h = path_hash(path);
+	struct dir_listing_t *l;
+	for (l = dir_cache[h]; l; l = l->next)
+		if (strcmp(l->path, path) == 0)
+			return l;
+
+	l = malloc(sizeof(struct dir_listing_t));
+	memset(l, 0, sizeof(struct dir_listing_t));
+	l->path = strdup(path);
+	l->next = dir_cache[h];
+	dir_cache[h] = l;
+
+	int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1) return l; // unreadable directories simply match nothing
+	size_t used = 0, size = 0, slots = 0;
+	long n;
+	while ((n = syscall(SYS_getdents64, fd, dents, sizeof(dents))) > 0)
+	{
+		for (long pos = 0; pos < n;)
+		{
+			struct linux_dirent64 *d = (struct linux_dirent64 *)(dents + pos);
+			pos += d->d_reclen;
+			if (d->d_name[0] == '.' && (d->d_name[1] == 0
+				|| (d->d_name[1] == '.' && d->d_name[2] == 0)))
+				continue; // skip . and ..
+			size_t len = strlen(d->d_name) + 1;
+			if (used + len > size)
+			{
+				size = (used + len) * 2;
+				l->names = realloc(l->names, size);
+			}
+			if (l->count == slots)
+			{
+				slots = slots ? slots * 2 : 64;
+				l->offsets = realloc(l->offsets, sizeof(size_t) * slots);
+				l->types = realloc(l->types, slots);
+			}
+			memcpy(l->names + used, d->d_name, len);
+			l->offsets[l->count] = used;
+			l->types[l->count++] = d->d_type;
+			used += len;
+		}
+	}
+	close(fd);
+	return l;
+}
+/**
+ * Drop the directory listings of the previous command line
+ */
+void dir_cache_clear()
+{
+	for (int i = 0; i < DIR_CACHE_BUCKETS; ++i)
+	{
+		while (dir_cache[i])
+		{
+			struct dir_listing_t *l = dir_cache[i];
+			dir_cache[i] = l->next;
+			free(l->path);
+			free(l->names);
+			free(l->offsets);
+			free(l->types);
+			free(l);
+		}
+	}
+}
+/**
+ * Match a character against a [...] class
+ * @param  p       points at the '[', moved past the ']' on success
+ * @param  c       [description]
+ * @return         1 or 0 for a match or not, -1 if the class is not closed
+ */
+int match_bracket(const char **p, char c)
+{
+	const char *q = *p + 1;
+	bool negate = false, matched = false;
+	if (*q == '!' || *q == '^')
+	{
+		negate = true;
+		q++;
+	}
+	if (*q == ']') // a leading ] is literal
+	{
+		matched = c == ']';
+		q++;
+	}
+	for (; *q != ']'; q++)
+	{
+		if (*q == 0) return -1;
+		if (q[1] == '-' && q[2] != 0 && q[2] != ']')
+		{
+			if ((unsigned char)c >= (unsigned char)q[0] && (unsigned char)c <= (unsigned char)q[2])
+				matched = true;
+			q += 2;
+		}
+		else if (*q == c)
+			matched = true;
+	}
+	*p = q + 1;
+	return matched != negate;
+}
+/**
+ * Match a name against a single path segment pattern with *, ? and [...]
+ * @param  p       [description]
+ * @param  s       [description]
+ * @return         [description]
+ */
+bool glob_match(const char *p, const char *s)
+{
+	const char *star_p = NULL, *star_s = NULL;
+	while (*s)
+	{
+		if (*p == '*') // remember the star, try matching it to nothing first
+		{
+			star_p = ++p;
+			star_s = s;
+			continue;
+		}
+		if (*p == '?')
+		{
+			p++;
+			s++;
+			continue;
+		}
+		int m = *p == '[' ? match_bracket(&p, *s) : -1;
+		if (m == 1)
+		{
+			s++;
+			continue;
+		}
+		if (m == -1 && *p != 0 && *p == *s)
+		{
+			p++;
+			s++;
+			continue;
+		}
+		if (!star_p) return false;
+		p = star_p; // let the last star swallow one more character
+		s = ++star_s;
+	}
+	while (*p == '*') p++;
+	return *p == 0;
+}
+/**
+ * A path segment pattern prepared once and then run against every entry
+ * of a directory
+ */
+struct glob_matcher_t {
+	const char *pattern;
+	bool simple; // prefix*suffix, compared with memcmp
+	bool dot; // starts with '.', so it may match hidden entries
+	size_t prefix_len, suffix_len;
+};
+void glob_compile(struct glob_matcher_t *m, const char *pattern)
+{
+	const char *star = strchr(pattern, '*');
+	m->pattern = pattern;
+	m->dot = pattern[0] == '.';
+	m->simple = star != NULL && strchr(star + 1, '*') == NULL && strpbrk(pattern, "?[") == NULL;
+	if (m->simple)
+	{
+		m->prefix_len = star - pattern;
+		m->suffix_len = strlen(star + 1);
+	}
+}
+bool glob_matcher_run(struct glob_matcher_t *m, const char *name)
+{
+	if (name[0] == '.' && !m->dot) return false;
+	if (!m->simple) return glob_match(m->pattern, name);
+	size_t len = strlen(name);
+	return len >= m->prefix_len + m->suffix_len
+		&& memcmp(name, m->pattern, m->prefix_len) == 0
+		&& memcmp(name + len - m->suffix_len, m->pattern + m->prefix_len + 1, m->suffix_len) == 0;
+}
+/**
+ * Check whether entry i of a listing is a directory
+ * @param  path    the directory path, with len bytes in use and room for the name
+ * @param  follow  follow symlinks, off for ** so that it cannot loop
+ * @return         [description]
+ */
+bool dir_entry_is_dir(struct dir_listing_t *l, size_t i, char *path, size_t len, bool follow)
+{
+	struct stat st;
+	if (l->types[i] == DT_DIR) return true;
+	if (l->types[i] != DT_UNKNOWN && (l->types[i] != DT_LNK || !follow)) return false;
+	const char *name = l->names + l->offsets[i];
+	if (len + strlen(name) + 1 > PATH_MAX) return false;
+	strcpy(path + len, name);
+	int r = follow ? stat(path, &st) : lstat(path, &st);
+	path[len] = 0;
+	return r == 0 && S_ISDIR(st.st_mode);
+}
+/**
+ * Expand the pattern rest relative to the path built so far
+ * @param  path    buffer of PATH_MAX bytes, len of them in use
+ * @param  rest    the remaining '/' separated pattern segments
+ * @param  exists  whether path is already known to exist
+ * @param  out     matched paths are added here
+ */
+void glob_walk(char *path, size_t len, const char *rest, bool exists, struct word_list_t *out)
+{
+	while (*rest == '/') rest++;
+	path[len] = 0;
+	if (*rest == 0)
+	{
+		struct stat st;
+		if (exists || lstat(path, &st) == 0)
+			word_list_add(out, strdup(path));
+		return;
+	}
+
+	const char *slash = strchr(rest, '/');
+	size_t seg_len = slash ? (size_t)(slash - rest) : strlen(rest);
+	const char *next = rest + seg_len;
+	char segment[NAME_MAX + 1];
+	if (seg_len > NAME_MAX || len + seg_len + 2 > PATH_MAX) return;
+	memcpy(segment, rest, seg_len);
+	segment[seg_len] = 0;
+
+	if (strpbrk(segment, "*?[") == NULL) // literal segment, no need to read the directory
+	{
+		memcpy(path + len, segment, seg_len);
+		if (slash) path[len + seg_len++] = '/';
+		glob_walk(path, len + seg_len, next, false, out);
+		return;
+	}
+
+	struct dir_listing_t *l = dir_list(len ? path : ".");
+	bool globstar = strcmp(segment, "**") == 0;
+	struct glob_matcher_t m;
+	glob_compile(&m, segment);
+	if (globstar && *next != 0 && next[1] != 0) // ** also matches no directory at all
+		glob_walk(path, len, next, exists, out);
+	else if (globstar && *next != 0 && len > 0) // trailing **/, each directory it walks into matches
+		word_list_add(out, strdup(path));
+
+	for (size_t i = 0; i < l->count; ++i)
+	{
+		const char *name = l->names + l->offsets[i];
+		size_t name_len = strlen(name);
+		if (!glob_matcher_run(&m, name) || len + name_len + 2 > PATH_MAX)
+			continue;
+		if (globstar)
+		{
+			bool is_dir = dir_entry_is_dir(l, i, path, len, false);
+			memcpy(path + len, name, name_len);
+			if (*next == 0) // trailing **, everything below matches
+			{
+				path[len + name_len] = 0;
+				word_list_add(out, strdup(path));
+			}
+			if (is_dir)
+			{
+				path[len + name_len] = '/';
+				glob_walk(path, len + name_len + 1, rest, true, out);
+			}
+			path[len] = 0;
+			continue;
+		}
+		if (slash && !dir_entry_is_dir(l, i, path, len, true))
+			continue;
+		memcpy(path + len, name, name_len);
+		if (slash) path[len + name_len++] = '/';
+		glob_walk(path, len + name_len, next, true, out);
+		path[len] = 0;
+	}
+}
+#define CHAR_AT(s, d) ((unsigned char)(s)[d])
+void swap_words(char **a, size_t i, size_t j)
+{
+	char *t = a[i];
+	a[i] = a[j];
+	a[j] = t;
+}
+/**
+ * Sort strings with a multikey quicksort: each pass partitions on a single
+ * character position, so long common prefixes are never compared again
+ * @param  a       [description]
+ * @param  n       [description]
+ * @param  depth   number of leading characters known to be equal
+ */
+void string_sort(char **a, size_t n, size_t depth)
+{
+	while (n > 1)
+	{
+		if (n < 12) // insertion sort for small ranges
+		{
+			for (size_t i = 1; i < n; ++i)
+				for (size_t j = i; j > 0 && strcmp(a[j - 1] + depth, a[j] + depth) > 0; --j)
+					swap_words(a, j - 1, j);
+			return;
+		}
+		int v = CHAR_AT(a[n / 2], depth);
+		size_t lt = 0, i = 0, gt = n;
+		while (i < gt)
+		{
+			int c = CHAR_AT(a[i], depth);
+			if (c < v) swap_words(a, lt++, i++);
+			else if (c > v) swap_words(a, i, --gt);
+			else i++;
+		}
+		string_sort(a, lt, depth);
+		string_sort(a + gt, n - gt, depth);
+		if (v == 0) return; // the middle range holds equal strings
+		a += lt;
+		n = gt - lt;
+		depth++;
+	}
+}
+/**
+ * Expand the first {a,b,...} group of a word, then the rest of it recursively
+ * @param  word    [description]
+ * @param  out     [description]
+ */
+void brace_expand(const char *word, struct word_list_t *out)
+{
+	for (const char *open = strchr(word, '{'); open; open = strchr(open + 1, '{'))
+	{
+		const char *close, *commas[256];
+		int depth = 0, n = 0;
+		for (close = open; *close; close++)
+		{
+			if (*close == '{') depth++;
+			else if (*close == '}' && --depth == 0) break;
+			else if (*close == ',' && depth == 1 && n < 256) commas[n++] = close;
+		}
+		if (*close == 0 || n == 0) continue; // not a brace group
+		size_t prefix = open - word, suffix = strlen(close + 1);
+		const char *alt = open + 1;
+		for (int i = 0; i <= n; ++i)
+		{
+			const char *alt_end = i < n ? commas[i] : close;
+			char *w = malloc(prefix + (alt_end - alt) + suffix + 1);
+			memcpy(w, word, prefix);
+			memcpy(w + prefix, alt, alt_end - alt);
+			strcpy(w + prefix + (alt_end - alt), close + 1);
+			brace_expand(w, out);
+			free(w);
+			alt = alt_end + 1;
+		}
+		return;
+	}
+	word_list_add(out, strdup(word));
+}
+/**
+ * Expand braces and *, ?, [...] and ** wildcards in an argument and append
+ * the results to the command. A pattern that matches nothing is kept as is.
+ * @param  arg       [description]
+ * @param  command   [description]
+ * @param  arg_index number of arguments already in the command
+ * @return           the new number of arguments
+ */
+int glob_expand(const char *arg, struct command_t *command, int arg_index)
+{
+	struct word_list_t words = { 0 }, matches;
+	char path[PATH_MAX];
+	brace_expand(arg, &words);
+	for (size_t i = 0; i < words.count; ++i)
+	{
+		memset(&matches, 0, sizeof(matches));
+		if (strpbrk(words.words[i], "*?[") != NULL)
+		{
+			size_t len = 0;
+			if (words.words[i][0] == '/')
+				path[len++] = '/';
+			glob_walk(path, len, words.words[i], true, &matches);
+		}
+		if (matches.count == 0)
+			word_list_add(&matches, strdup(words.words[i]));
+		else
+			string_sort(matches.words, matches.count, 0);
+
+		command->args = (char **)realloc(command->args, sizeof(char *)*(arg_index + matches.count));
+		for (size_t j = 0; j < matches.count; ++j)
+			command->args[arg_index++] = matches.words[j];
+		free(matches.words);
+		free(words.words[i]);
+	}
+	free(words.words);
+	return arg_index;
+}
+#define SUBST_MARK '\001' // stands in for a $(...) in the line given to parse_command
+#define SUBST_END '\002'
+/**
+ * The words printed by each $(...) of a command line, in order. Its place
+ * in the line is marked with SUBST_MARK, the index and SUBST_END, so that
+ * the words go straight into args and are never parsed as shell syntax.
+ * Quoted uses and redirect targets take the raw output instead.
+ */
+struct substitutions_t {
+	struct word_list_t *outputs;
+	char **raw; // each output as printed, without its trailing newlines
+	size_t count;
+};
+struct substitutions_t *parse_substitutions; // for the line parse_command is working on
+void free_substitutions(struct substitutions_t *subs)
+{
+	for (size_t i = 0; i < subs->count; ++i)
+	{
+		for (size_t j = 0; j < subs->outputs[i].count; ++j)
+			free(subs->outputs[i].words[j]);
+		free(subs->outputs[i].words);
+		free(subs->raw[i]);
+	}
+	free(subs->outputs);
+	free(subs->raw);
+	memset(subs, 0, sizeof(struct substitutions_t));
+}
+/**
+ * Replace the substitution markers in a token with the captured words.
+ * Text around a marker sticks to the first and the last word, as in sh.
+ * @param  arg     [description]
+ * @param  join    make a single word of the output as printed (quoted or redirect)
+ * @param  out     the resulting words are added here
+ */
+void splice_substitutions(const char *arg, bool join, struct word_list_t *out)
+{
+	struct capture_t word = { 0 };
+	bool pending = join; // word holds something that must become an argument
+	for (const char *p = arg; *p; ++p)
+	{
+		if (*p != SUBST_MARK)
+		{
+			capture_append(&word, p, 1);
+			pending = true;
+			continue;
+		}
+		char *end;
+		size_t index = strtoul(p + 1, &end, 10);
+		p = *end == SUBST_END ? end : end - 1;
+		if (parse_substitutions == NULL || index >= parse_substitutions->count) continue;
+		if (join) // a single word, kept as printed
+		{
+			capture_append(&word, parse_substitutions->raw[index], strlen(parse_substitutions->raw[index]));
+			continue;
+		}
+		struct word_list_t *words = &parse_substitutions->outputs[index];
+		for (size_t i = 0; i < words->count; ++i)
+		{
+			if (i > 0) // the previous word is complete
+			{
+				capture_append(&word, "", 1);
+				word_list_add(out, word.data);
+				memset(&word, 0, sizeof(word));
+			}
+			capture_append(&word, words->words[i], strlen(words->words[i]));
+			pending = true;
+		}
+	}
+	if (pending)
+	{
+		capture_append(&word, "", 1);
+		word_list_add(out, word.data);
+	}
+	else
+		free(word.data);
+}
 /**
  * Parse a command string into a command struct
  * @param  buf     [description]
@@ -110,17 +763,29 @@ int parse_command(char *buf, struct command_t *command)
 		command->background = true;
 
 	char *pch = strtok(buf, splitters);
-	command->name = (char *)malloc(strlen(pch) + 1);
-	if (pch == NULL)
-		command->name[0] = 0;
-	else
-		strcpy(command->name, pch);
-
 	command->args = (char **)malloc(sizeof(char *));
+	int arg_index = 0;
+	struct word_list_t words = { 0 };
+	if (pch != NULL && strchr(pch, SUBST_MARK) != NULL) // the name comes from $(...), the rest of its words are arguments
+	{
+		splice_substitutions(pch, false, &words);
+		command->name = words.count ? words.words[0] : strdup("");
+		command->args = (char **)realloc(command->args, sizeof(char *)*(words.count + 1));
+		for (size_t i = 1; i < words.count; ++i)
+			command->args[arg_index++] = words.words[i];
+		free(words.words);
+	}
+	else
+	{
+		command->name = (char *)malloc(pch ? strlen(pch) + 1 : 1);
+		if (pch == NULL)
+			command->name[0] = 0;
+		else
+			strcpy(command->name, pch);
+	}
 
 	int redirect_index;
-	int arg_index = 0;
-	char temp_buf[1024], *arg;
+	char *temp_buf = malloc(len + 1), *arg; // no token is longer than the line
 	while (1)
 	{
 		// tokenize input on splitters
@@ -143,6 +808,7 @@ int parse_command(char *buf, struct command_t *command)
 		if (strcmp(arg, "|") == 0)
 		{
 			struct command_t *c = malloc(sizeof(struct command_t));
+			memset(c, 0, sizeof(struct command_t)); // set all bytes to 0
 			int l = strlen(pch);
 			pch[l] = splitters[0]; // restore strtok termination
 			index = 1;
@@ -174,52 +840,194 @@ int parse_command(char *buf, struct command_t *command)
 		}
 		if (redirect_index != -1)
 		{
-			command->redirects[redirect_index] = malloc(len);
-			strcpy(command->redirects[redirect_index], arg + 1);
+			char *target = arg + 1;
+			if (len == 1 && (pch = strtok(NULL, splitters)) != NULL) // file name given as the next token
+				target = pch;
+			free(command->redirects[redirect_index]); // the last one given wins
+			if (strchr(target, SUBST_MARK) != NULL) // file name from $(...), taken as a single word
+			{
+				memset(&words, 0, sizeof(words));
+				splice_substitutions(target, true, &words);
+				command->redirects[redirect_index] = words.words[0];
+				free(words.words);
+			}
+			else
+				command->redirects[redirect_index] = strdup(target);
 			continue;
 		}
 
 		// normal arguments
+		bool quoted = false;
 		if (len > 2 && ((arg[0] == '"' && arg[len - 1] == '"')
 			|| (arg[0] == '\'' && arg[len - 1] == '\''))) // quote wrapped arg
 		{
 			arg[--len] = 0;
 			arg++;
+			quoted = true;
+		}
+		if (strchr(arg, SUBST_MARK) != NULL) // words from $(...) go straight into args
+		{
+			memset(&words, 0, sizeof(words));
+			splice_substitutions(arg, quoted, &words);
+			command->args = (char **)realloc(command->args, sizeof(char *)*(arg_index + words.count + 1));
+			for (size_t i = 0; i < words.count; ++i)
+				command->args[arg_index++] = words.words[i];
+			free(words.words);
+			continue;
+		}
+		if (!quoted && !command->auto_complete && strpbrk(arg, "*?[{") != NULL) // wildcards and braces
+		{
+			arg_index = glob_expand(arg, command, arg_index);
+			continue;
 		}
 		command->args = (char **)realloc(command->args, sizeof(char *)*(arg_index + 1));
 		command->args[arg_index] = (char *)malloc(len + 1);
 		strcpy(command->args[arg_index++], arg);
 	}
 	command->arg_count = arg_index;
+	free(temp_buf);
 	return 0;
 }
-void prompt_backspace()
+#define STREAM_BUFSIZE (1 << 16) // bytes requested per read()
+/**
+ * Buffered reader over a file or pipe, used by the builtins so that
+ * they can stream their input. Memory use stays at STREAM_BUFSIZE unless
+ * a single line is longer than that.
+ */
+struct stream_t {
+	int fd;
+	bool owns_fd; // false when reading the shell's stdin
+	bool eof;
+	bool follow; // end of file is not final, a partial last line waits for more data
+	char *buf;
+	size_t size; // capacity, one extra byte is kept for the terminator
+	size_t start, end; // unread data is buf[start..end)
+};
+/**
+ * Open a stream on a file, or on stdin when path is NULL or "-"
+ * @param  path    [description]
+ * @return         the stream, NULL on error (errno is set)
+ */
+struct stream_t *stream_open(const char *path)
 {
-	putchar(8); // go back 1
-	putchar(' '); // write empty over
-	putchar(8); // go back 1 again
+	int fd = STDIN_FILENO;
+	bool owns_fd = false;
+	if (path != NULL && strcmp(path, "-") != 0)
+	{
+		fd = open(path, O_RDONLY);
+		if (fd == -1) return NULL;
+		owns_fd = true;
+	}
+	struct stream_t *s = malloc(sizeof(struct stream_t));
+	memset(s, 0, sizeof(struct stream_t));
+	s->fd = fd;
+	s->owns_fd = owns_fd;
+	s->size = STREAM_BUFSIZE;
+	s->buf = malloc(s->size + 1);
+	return s;
+}
+void stream_close(struct stream_t *s)
+{
+	if (s->owns_fd)
+		close(s->fd);
+	free(s->buf);
+	free(s);
 }
 /**
- * Prompt a command from the user
- * @param  buf      [description]
- * @param  buf_size [description]
- * @return          [description]
+ * Read more data into the stream, compacting or growing the buffer first
+ * @param  s       [description]
+ * @return         number of bytes read, 0 on end of input, -1 on error
  */
-int prompt(struct command_t *command)
+ssize_t stream_fill(struct stream_t *s)
 {
-	int index = 0;
-	char c;
-	char buf[4096];
-	static char oldbuf[4096];
-
-	// tcgetattr gets the parameters of the current terminal
-	// STDIN_FILENO will tell tcgetattr that it should write the settings
-	// of stdin to oldt
-	static struct termios backup_termios, new_termios;
-	tcgetattr(STDIN_FILENO, &backup_termios);
-	new_termios = backup_termios;
-	// ICANON normally takes care that one line at a time will be processed
-	// that means it will return if it sees a "\n" or an EOF or an EOL
+	ssize_t n;
+	if (s->eof) return 0;
+	if (s->start > 0) // move the unread tail to the front
+	{
+		memmove(s->buf, s->buf + s->start, s->end - s->start);
+		s->end -= s->start;
+		s->start = 0;
+	}
+	if (s->end == s->size) // a single line fills the buffer
+	{
+		s->size *= 2;
+		s->buf = realloc(s->buf, s->size + 1);
+	}
+	do
+		n = read(s->fd, s->buf + s->end, s->size - s->end);
+	while (n == -1 && errno == EINTR);
+	if (n <= 0)
+		s->eof = !s->follow;
+	else
+		s->end += n;
+	return n;
+}
+/**
+ * Get the next line of a stream. The newline is replaced by a terminator,
+ * and the line stays valid until the next call on the same stream.
+ * @param  s       [description]
+ * @param  len     set to the line length without the newline
+ * @return         the line, NULL at end of input
+ */
+char *stream_getline(struct stream_t *s, size_t *len)
+{
+	size_t scanned = 0;
+	char *line, *nl;
+	while ((nl = memchr(s->buf + s->start + scanned, '\n', s->end - s->start - scanned)) == NULL)
+	{
+		scanned = s->end - s->start;
+		if (stream_fill(s) <= 0)
+		{
+			if (s->end == s->start || s->follow) return NULL;
+			nl = s->buf + s->end; // last line without a newline
+			break;
+		}
+	}
+	line = s->buf + s->start;
+	*len = nl - line;
+	*nl = 0;
+	s->start += *len + (s->start + *len < s->end ? 1 : 0);
+	return line;
+}
+/**
+ * Get the next byte of a stream
+ * @param  s       [description]
+ * @return         the byte, EOF at end of input
+ */
+int stream_getc(struct stream_t *s)
+{
+	if (s->start == s->end && stream_fill(s) <= 0)
+		return EOF;
+	return (unsigned char)s->buf[s->start++];
+}
+void prompt_backspace()
+{
+	putchar(8); // go back 1
+	putchar(' '); // write empty over
+	putchar(8); // go back 1 again
+}
+char *substitute_commands(const char *buf, struct substitutions_t *subs);
+/**
+ * Prompt a command from the user
+ * @param  buf      [description]
+ * @param  buf_size [description]
+ * @return          [description]
+ */
+int prompt(struct command_t *command)
+{
+	int index = 0;
+	int c;
+	char buf[4096];
+	static char oldbuf[4096];
+
+	// tcgetattr gets the parameters of the current terminal
+	// STDIN_FILENO will tell tcgetattr that it should write the settings
+	// of stdin to oldt
+	static struct termios backup_termios, new_termios;
+	tcgetattr(STDIN_FILENO, &backup_termios);
+	new_termios = backup_termios;
+	// ICANON normally takes care that one line at a time will be processed
+	// that means it will return if it sees a "\n" or an EOF or an EOL
 	new_termios.c_lflag &= ~(ICANON | ECHO); // Also disable automatic echo. We manually echo each char.
 	// Those new settings will be set to STDIN
 	// TCSANOW tells tcsetattr to change attributes immediately.
@@ -233,6 +1041,11 @@ int prompt(struct command_t *command)
 	while (1)
 	{
 		c = getchar();
+		if (c == EOF) // input closed, leave like Ctrl+D
+		{
+			tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
+			return EXIT;
+		}
 		// printf("Keycode: %u\n", c); // DEBUG: uncomment for debugging
 
 		if (c == 9) // handle tab
@@ -285,7 +1098,10 @@ int prompt(struct command_t *command)
 		if (c == '\n') // enter key
 			break;
 		if (c == 4) // Ctrl+D
+		{
+			tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
 			return EXIT;
+		}
 	}
 	if (index > 0 && buf[index - 1] == '\n') // trim newline from the end
 		index--;
@@ -293,161 +1109,1119 @@ int prompt(struct command_t *command)
 
 	strcpy(oldbuf, buf);
 
-	parse_command(buf, command);
+	// restore the old settings, commands in $(...) run with the normal terminal
+	tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
 
-	// print_command(command); // DEBUG: uncomment for debugging
+	struct substitutions_t subs = { 0 };
+	char *line = substitute_commands(buf, &subs);
+	parse_substitutions = &subs;
+	parse_command(line, command);
+	parse_substitutions = NULL;
+	dir_cache_clear();
+	free_substitutions(&subs);
+	free(line);
 
-	// restore the old settings
-	tcsetattr(STDIN_FILENO, TCSANOW, &backup_termios);
+	// print_command(command); // DEBUG: uncomment for debugging
 	return SUCCESS;
 }
 int process_command(struct command_t *command);
-int main()
+/**
+ * Print a line if it contains the word, with every match colored
+ * @param  line     [description]
+ * @param  len      [description]
+ * @param  word     [description]
+ * @param  colorval [description]
+ */
+void highlight_line(char *line, size_t len, const char *word, const char *colorval)
 {
-	while (1)
+	const char *normal = "\033[0m";
+	size_t search_length = strlen(word);
+	char *token, *end;
+	bool valid = false; //tracks if we should be printing a line or not.
+
+	// tokens are separated by spaces, matched case insensitively
+	for (token = line; *token; token = end) {
+		while (*token == ' ') token++;
+		end = token;
+		while (*end && *end != ' ') end++;
+		if (end - token == search_length && strncasecmp(token, word, search_length) == 0) {
+			valid = true;
+			break;
+		}
+	}
+	if (!valid) return;
+
+	for (token = line; *token; token = end) { // print the line with the matching tokens colored
+		while (*token == ' ') token++;
+		end = token;
+		while (*end && *end != ' ') end++;
+		if (end == token) break;
+		*end = ' '; // the line is ours until the next read, write the token and its space at once
+		if (end - token == search_length && strncasecmp(token, word, search_length) == 0)
+		{
+			out_puts(colorval);
+			out_write(token, end - token);
+			out_puts(normal);
+			out_write(" ", 1);
+		}
+		else
+			out_write(token, end - token + 1);
+		if (end == line + len) break;
+	}
+	out_write(" \n", 2);
+}
+#define FOLLOW_POLL_MS 100 // how often the file is checked when inotify is not available
+#define FOLLOW_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+volatile sig_atomic_t follow_interrupted;
+void follow_interrupt(int sig)
+{
+	follow_interrupted = 1;
+}
+/**
+ * Keep highlighting the lines appended to a file until Ctrl+C. Sleeps on
+ * inotify, or checks the file every FOLLOW_POLL_MS when inotify cannot be
+ * used. A truncated file is read again from the start, and a renamed or
+ * replaced file is reopened by name once the old one is drained.
+ * @param  s        stream on the file, already read to its end
+ * @param  path     [description]
+ * @param  word     [description]
+ * @param  colorval [description]
+ */
+void highlight_follow(struct stream_t *s, const char *path, const char *word, const char *colorval)
+{
+	char dir[PATH_MAX], events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char *slash = strrchr(path, '/');
+	struct sigaction sa, old_sa;
+	struct stat st, now;
+	char *line;
+	size_t len;
+
+	// the directory is watched too, so that a new file under the same name is noticed
+	if (slash == NULL) strcpy(dir, ".");
+	else snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = follow_interrupt; // no SA_RESTART, so poll returns on Ctrl+C
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, &old_sa);
+	follow_interrupted = 0;
+
+	int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	int file_wd = ifd == -1 ? -1 : inotify_add_watch(ifd, path, FOLLOW_EVENTS);
+	if (file_wd == -1 || inotify_add_watch(ifd, dir, IN_CREATE | IN_MOVED_TO) == -1)
 	{
-		struct command_t *command = malloc(sizeof(struct command_t));
-		memset(command, 0, sizeof(struct command_t)); // set all bytes to 0
+		if (ifd != -1) close(ifd);
+		ifd = -1;
+	}
+	struct pollfd pfd = { ifd, POLLIN, 0 };
 
-		int code;
-		code = prompt(command);
-		if (code == EXIT) break;
+	while (1)
+	{
+		while ((line = stream_getline(s, &len)) != NULL)
+			highlight_line(line, len, word, colorval);
 
-		code = process_command(command);
-		if (code == EXIT) break;
+		if (fstat(s->fd, &st) == 0 && st.st_size < lseek(s->fd, 0, SEEK_CUR)) // truncated
+		{
+			lseek(s->fd, 0, SEEK_SET);
+			s->start = s->end = 0;
+			continue;
+		}
+		if (stat(path, &now) == 0 && (now.st_ino != st.st_ino || now.st_dev != st.st_dev)) // rotated
+		{
+			int fd = open(path, O_RDONLY | O_CLOEXEC);
+			if (fd != -1)
+			{
+				if (s->end > s->start) // the old file ended without a newline
+				{
+					s->buf[s->end] = 0;
+					highlight_line(s->buf + s->start, s->end - s->start, word, colorval);
+				}
+				close(s->fd);
+				s->fd = fd;
+				s->start = s->end = 0;
+				if (ifd != -1)
+				{
+					inotify_rm_watch(ifd, file_wd);
+					file_wd = inotify_add_watch(ifd, path, FOLLOW_EVENTS);
+				}
+				continue;
+			}
+		}
 
-		free_command(command);
+		if (follow_interrupted) break;
+		out_flush();
+		int r = ifd != -1 ? poll(&pfd, 1, -1) : poll(NULL, 0, FOLLOW_POLL_MS);
+		if (r == -1 && errno != EINTR) break;
+		if (ifd != -1)
+			while (read(ifd, events, sizeof(events)) > 0); // which event it was does not matter, the checks above cover all
 	}
 
-	printf("\n");
-	return 0;
+	if (ifd != -1) close(ifd);
+	sigaction(SIGINT, &old_sa, NULL);
+	out_write("\n", 1);
 }
-
-int process_command(struct command_t *command)
+/**
+ * Print the lines of a file, or of stdin, that contain a word, with the word colored.
+ * With -f the file is followed: lines appended later are highlighted as they arrive.
+ * seashell> highlight [-f] <word> <r | g | b> [filename | -]
+ * @param  command [description]
+ * @return         [description]
+ */
+int highlight(struct command_t *command)
 {
-	int r;
-	if (strcmp(command->name, "") == 0) return SUCCESS;
+	char *colorval, *line, *path;
+	char input_color;
+	size_t len;
+	bool follow = command->arg_count > 0 && strcmp(command->args[0], "-f") == 0;
+	char **args = command->args + follow;
+	int arg_count = command->arg_count - follow;
+
+	if (arg_count < 2)
+	{
+		out_printf("Usage: highlight [-f] <word> <r | g | b> [filename | -]\n");
+		return SUCCESS;
+	}
+	if (strlen(args[1]) == 1) { //check if single letter
+		input_color = *args[1]; //char* to char conversion
+	}
+	else {
+		out_printf("-%s: %s: invalid color: %s\n", sysname, command->name, args[1]);
+		return SUCCESS;
+	}
 
-	if (strcmp(command->name, "exit") == 0)
-		return EXIT;
+	switch (input_color) { //char conversion allows me to use switch
+	case 'r': colorval = "\033[0;31m"; break;
+	case 'g': colorval = "\033[0;32m"; break;
+	case 'b': colorval = "\033[0;34m"; break;
+	default:
+		out_printf("-%s: %s: invalid color: %s\n", sysname, command->name, args[1]);
+		return SUCCESS;
+	}
 
-	if (strcmp(command->name, "cd") == 0)
-	{
-		if (command->arg_count > 0)
-		{
-			r = chdir(command->args[0]);
-			if (r == -1)
-				printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
-			return SUCCESS;
-		}
+	// no filename or "-" reads stdin, so highlight can sit at the end of a pipe
+	path = arg_count > 2 && strcmp(args[2], "-") != 0 ? args[2] : NULL;
+	struct stream_t *textfile = stream_open(path);
+	if (textfile == NULL) {
+		out_printf("-%s: %s: %s: %s\n", sysname, command->name, path, strerror(errno));
+		return SUCCESS;
 	}
+	textfile->follow = follow && path != NULL; // a pipe is followed anyway, until its writer closes it
 
-	if (strcmp(command->name, "highlight") == 0) {
-		//seashell> highlight <word> <r | g | b> <filename>
+	while ((line = stream_getline(textfile, &len)) != NULL)
+		highlight_line(line, len, args[0], colorval);
+	if (textfile->follow)
+		highlight_follow(textfile, path, args[0], colorval);
 
-		FILE *textfile = fopen(command->args[2], "r");
-		if (textfile != NULL) {
-			char *colorval, *normal, line[512];
-			char input_color;
+	stream_close(textfile);
+	return SUCCESS;
+}
+/**
+ * Compare two files line by line (-a) or byte by byte (-b).
+ * Either file may be "-" or the second one left out to read stdin.
+ * seashell> kdiff <-a | -b> <file1> [file2 | -]
+ * @param  command [description]
+ * @return         [description]
+ */
+int kdiff(struct command_t *command)
+{
+	if (command->arg_count < 2)
+	{
+		out_printf("Usage: kdiff <-a | -b> <file1> [file2 | -]\n");
+		return SUCCESS;
+	}
+	char *flag = command->args[0]; // this takes the parameter -a or -b
+	char *first_txt = command->args[1]; // name of first txt
+	char *second_txt = command->arg_count > 2 ? command->args[2] : "-"; // name of second txt
+	if (strcmp(first_txt, "-") == 0 && strcmp(second_txt, "-") == 0)
+	{
+		out_printf("-%s: %s: only one file can be read from stdin\n", sysname, command->name);
+		return SUCCESS;
+	}
+	struct stream_t *fp1 = stream_open(first_txt); // first txt file
+	if (fp1 == NULL)
+	{
+		out_printf("-%s: %s: %s: %s\n", sysname, command->name, first_txt, strerror(errno));
+		return SUCCESS;
+	}
+	struct stream_t *fp2 = stream_open(second_txt); // second txt file
+	if (fp2 == NULL)
+	{
+		out_printf("-%s: %s: %s: %s\n", sysname, command->name, second_txt, strerror(errno));
+		stream_close(fp1);
+		return SUCCESS;
+	}
 
-			if (strlen(command->args[1]) == 1) { //check if single letter
-				input_color = *command->args[1]; //char* to char conversion
+	if (strcmp(flag, "-a") == 0) {  // case we compare line by line
+		char *line1, *line2;
+		size_t len1, len2;
+		int mismatch_counter = 0;  // counter for mismatches
+		int line_counter = 0;  // counts the lines
+		while (1) {
+			line1 = stream_getline(fp1, &len1);
+			line2 = stream_getline(fp2, &len2);
+			if (line1 == NULL && line2 == NULL) break;
+			line_counter++;
+			if (line1 == NULL) { // case that first txt ends but not second txt. Printing extra lines
+				mismatch_counter++;
+				out_printf("%s :Line %d: %s\n", second_txt, line_counter, line2);
+				out_printf("%s :Line %d:is null \n", first_txt, line_counter);
+			}
+			else if (line2 == NULL) { // case that second txt ends but not first txt. Printing extra lines
+				mismatch_counter++;
+				out_printf("%s :Line %d: %s\n", first_txt, line_counter, line1);
+				out_printf("%s :Line %d:is null  \n", second_txt, line_counter);
 			}
-			else {
-				printf("Invalid color.\n"); return EXIT;
+			else if (len1 != len2 || memcmp(line1, line2, len1) != 0) {  // checks if the lines are identical if they are not counters updated lines are printed
+				mismatch_counter++;
+				out_printf("%s :Line %d: %s\n", first_txt, line_counter, line1);
+				out_printf("%s :Line %d: %s\n", second_txt, line_counter, line2);
 			}
+		}
+		if (mismatch_counter != 0) { // if the all lines are not identical print how many lines are different
+			out_printf("%d different line found \n", mismatch_counter);
+		}
+		else {
+			out_printf("All lines are identical \n");
+		}
+	}
+	else { // this part implements -b case which is bitwise comparison
+		int char1, char2;
+		int bitcntr = 0;
+		while (1) { // compares byte by byte, the longer file counts its extra bytes
+			char1 = stream_getc(fp1);
+			char2 = stream_getc(fp2);
+			if (char1 == EOF && char2 == EOF) break;
+			if (char1 != char2) bitcntr++;
+		}
+		if (bitcntr == 0) out_printf("Two files are identical \n ");
+		if (bitcntr != 0) out_printf("Files are different in  %d bytes \n", bitcntr);
+	}
+	stream_close(fp1);
+	stream_close(fp2);
+	return SUCCESS;
+}
+#define NUMA_NODES 64 // nodes that fit in the set_mempolicy mask below
+/**
+ * CPU placement, memory placement, resource limits and priority applied
+ * to a launched command between fork and exec
+ */
+struct exec_policy_t {
+	bool has_cpus;
+	cpu_set_t cpus;
+	int mempolicy; // MPOL_DEFAULT leaves memory placement alone
+	unsigned long nodes;
+	bool has_nice;
+	int nice;
+	rlim_t limits[RLIM_NLIMITS];
+	bool has_limit[RLIM_NLIMITS];
+};
+struct exec_policy_t session_policy; // defaults set with a bare pin, numa, limit or nice
+/**
+ * Resource names accepted by limit
+ */
+struct limit_name_t {
+	const char *name;
+	int resource;
+	bool seconds; // value is a time, otherwise a size or count
+} limit_names[] = {
+	{ "mem", RLIMIT_AS, false },
+	{ "cpu", RLIMIT_CPU, true },
+	{ "nofile", RLIMIT_NOFILE, false },
+	{ "nproc", RLIMIT_NPROC, false },
+	{ "stack", RLIMIT_STACK, false },
+	{ "fsize", RLIMIT_FSIZE, false },
+	{ "core", RLIMIT_CORE, false },
+};
+#define LIMIT_NAME_COUNT (sizeof(limit_names) / sizeof(limit_names[0]))
+bool is_policy_prefix(const char *name)
+{
+	return strcmp(name, "pin") == 0 || strcmp(name, "numa") == 0
+		|| strcmp(name, "limit") == 0 || strcmp(name, "nice") == 0;
+}
+/**
+ * Parse a list of ids like 0-3,8,10-11
+ * @param  s       [description]
+ * @param  set     called for every id in the list
+ * @param  max     ids must be below this
+ * @return         0, or -1 if the list is malformed
+ */
+int parse_id_list(const char *s, void (*set)(int, void *), void *data, int max)
+{
+	char *end;
+	do
+	{
+		long first = strtol(s, &end, 10), last = first;
+		if (end == s || first < 0) return -1;
+		if (*end == '-')
+		{
+			s = end + 1;
+			last = strtol(s, &end, 10);
+			if (end == s || last < first) return -1;
+		}
+		if (last >= max) return -1;
+		for (long id = first; id <= last; ++id)
+			set(id, data);
+		s = end + 1;
+	} while (*end == ',');
+	return *end == 0 ? 0 : -1;
+}
+void set_cpu(int id, void *data)
+{
+	CPU_SET(id, (cpu_set_t *)data);
+}
+void set_node(int id, void *data)
+{
+	*(unsigned long *)data |= 1UL << id;
+}
+/**
+ * Parse a size with an optional K, M, G or T suffix, or a time with an
+ * optional s, m or h suffix
+ * @return         0, or -1 if the value is malformed
+ */
+int parse_limit_value(const char *s, bool seconds, rlim_t *value)
+{
+	char *end;
+	if (strcmp(s, "unlimited") == 0)
+	{
+		*value = RLIM_INFINITY;
+		return 0;
+	}
+	if (!isdigit((unsigned char)*s)) return -1; // strtoull would accept a sign
+	errno = 0;
+	unsigned long long v = strtoull(s, &end, 10);
+	if (end == s || errno == ERANGE) return -1;
+	int shift = 0;
+	unsigned long long scale = 1;
+	if (seconds)
+	{
+		switch (*end)
+		{
+		case 0: case 's': break;
+		case 'm': scale = 60; break;
+		case 'h': scale = 3600; break;
+		default: return -1;
+		}
+	}
+	else
+	{
+		switch (*end)
+		{
+		case 0: break;
+		case 'k': case 'K': shift = 10; break;
+		case 'm': case 'M': shift = 20; break;
+		case 'g': case 'G': shift = 30; break;
+		case 't': case 'T': shift = 40; break;
+		default: return -1;
+		}
+	}
+	if (*end && end[1] != 0) return -1;
+	if (v > (RLIM_INFINITY - 1) >> shift || v > (RLIM_INFINITY - 1) / scale) return -1; // would wrap or mean unlimited
+	*value = (rlim_t)(v << shift) * scale;
+	return 0;
+}
+/**
+ * Read the options of one pin, numa, limit or nice prefix into a policy
+ * seashell> pin <cpus | off> [command]
+ * seashell> numa <node | interleave | preferred>=<nodes> [command], or numa off
+ * seashell> limit <mem | cpu | nofile | nproc | stack | fsize | core>=<value>... [command], or limit off
+ * seashell> nice [-n] <increment | off> [command]
+ * @param  command [description]
+ * @param  policy  [description]
+ * @return         number of arguments used, -1 on error
+ */
+int parse_policy(struct command_t *command, struct exec_policy_t *policy)
+{
+	char **args = command->args;
+	int count = command->arg_count;
+	if (count == 0) return 0;
 
-			switch (input_color) { //char conversion allows me to use switch
-			case 'r': colorval = "\033[0;31m"; break;
-			case 'g': colorval = "\033[0;32m"; break;
-			case 'b': colorval = "\033[0;34m"; break;
-			default: printf("Invalid color.\n"); return EXIT;
+	if (strcmp(command->name, "pin") == 0)
+	{
+		policy->has_cpus = strcmp(args[0], "off") != 0;
+		CPU_ZERO(&policy->cpus);
+		if (policy->has_cpus && parse_id_list(args[0], set_cpu, &policy->cpus, CPU_SETSIZE) == -1)
+		{
+			out_printf("-%s: pin: invalid cpu list: %s\n", sysname, args[0]);
+			return -1;
+		}
+		cpu_set_t usable;
+		if (policy->has_cpus && sched_getaffinity(0, sizeof(usable), &usable) == 0)
+		{
+			CPU_AND(&usable, &usable, &policy->cpus);
+			if (CPU_COUNT(&usable) == 0) // every command would fail in apply_policy
+			{
+				out_printf("-%s: pin: no usable cpu in list: %s\n", sysname, args[0]);
+				return -1;
 			}
+		}
+		return 1;
+	}
+	if (strcmp(command->name, "numa") == 0)
+	{
+		char *value = strchr(args[0], '=');
+		policy->mempolicy = MPOL_DEFAULT;
+		policy->nodes = 0;
+		if (strcmp(args[0], "off") == 0) return 1;
+		if (value != NULL && strncmp(args[0], "node=", 5) == 0) policy->mempolicy = MPOL_BIND;
+		else if (value != NULL && strncmp(args[0], "interleave=", 11) == 0) policy->mempolicy = MPOL_INTERLEAVE;
+		else if (value != NULL && strncmp(args[0], "preferred=", 10) == 0) policy->mempolicy = MPOL_PREFERRED;
+		if (policy->mempolicy == MPOL_DEFAULT || parse_id_list(value + 1, set_node, &policy->nodes, NUMA_NODES) == -1)
+		{
+			out_printf("-%s: numa: invalid node policy: %s\n", sysname, args[0]);
+			return -1;
+		}
+		return 1;
+	}
+	if (strcmp(command->name, "limit") == 0)
+	{
+		int used = 0;
+		if (strcmp(args[0], "off") == 0)
+		{
+			memset(policy->has_limit, 0, sizeof(policy->has_limit));
+			return 1;
+		}
+		for (; used < count && strchr(args[used], '=') != NULL; ++used)
+		{
+			char *value = strchr(args[used], '=');
+			size_t i;
+			for (i = 0; i < LIMIT_NAME_COUNT; ++i)
+				if (strncmp(args[used], limit_names[i].name, value - args[used]) == 0
+					&& limit_names[i].name[value - args[used]] == 0)
+					break;
+			int resource = i < LIMIT_NAME_COUNT ? limit_names[i].resource : 0;
+			if (i == LIMIT_NAME_COUNT
+				|| parse_limit_value(value + 1, limit_names[i].seconds, &policy->limits[resource]) == -1)
+			{
+				out_printf("-%s: limit: invalid limit: %s\n", sysname, args[used]);
+				return -1;
+			}
+			policy->has_limit[resource] = true;
+		}
+		if (used == 0)
+		{
+			out_printf("-%s: limit: expected name=value\n", sysname);
+			return -1;
+		}
+		return used;
+	}
+	// nice
+	int used = strcmp(args[0], "-n") == 0 ? 1 : 0;
+	char *end;
+	if (used == count)
+	{
+		out_printf("-%s: nice: expected an increment\n", sysname);
+		return -1;
+	}
+	policy->has_nice = strcmp(args[used], "off") != 0;
+	policy->nice = policy->has_nice ? strtol(args[used], &end, 10) : 0;
+	if (policy->has_nice && (end == args[used] || *end != 0))
+	{
+		out_printf("-%s: nice: invalid increment: %s\n", sysname, args[used]);
+		return -1;
+	}
+	return used + 1;
+}
+/**
+ * Print a policy in the same syntax the prefixes accept
+ * @param  policy  [description]
+ */
+void print_policy(struct exec_policy_t *policy)
+{
+	if (policy->has_cpus)
+	{
+		out_puts("pin ");
+		for (int cpu = 0, sep = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (!CPU_ISSET(cpu, &policy->cpus)) continue;
+			int last = cpu;
+			while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &policy->cpus)) last++;
+			out_printf(last > cpu ? "%s%d-%d" : "%s%d", sep++ ? "," : "", cpu, last);
+			cpu = last;
+		}
+		out_puts("\n");
+	}
+	if (policy->mempolicy != MPOL_DEFAULT)
+	{
+		out_puts(policy->mempolicy == MPOL_BIND ? "numa node=" :
+			policy->mempolicy == MPOL_INTERLEAVE ? "numa interleave=" : "numa preferred=");
+		for (int node = 0, sep = 0; node < NUMA_NODES; ++node)
+			if (policy->nodes & (1UL << node))
+				out_printf("%s%d", sep++ ? "," : "", node);
+		out_puts("\n");
+	}
+	for (size_t i = 0; i < LIMIT_NAME_COUNT; ++i)
+	{
+		int resource = limit_names[i].resource;
+		if (!policy->has_limit[resource]) continue;
+		if (policy->limits[resource] == RLIM_INFINITY)
+			out_printf("limit %s=unlimited\n", limit_names[i].name);
+		else
+			out_printf("limit %s=%llu\n", limit_names[i].name, (unsigned long long)policy->limits[resource]);
+	}
+	if (policy->has_nice)
+		out_printf("nice %d\n", policy->nice);
+}
+/**
+ * Apply a policy to the current process, called in the child before exec
+ * @param  policy  [description]
+ * @return         0, or -1 if any part could not be applied
+ */
+int apply_policy(struct exec_policy_t *policy)
+{
+	if (policy->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &policy->cpus) == -1)
+	{
+		out_printf("-%s: pin: %s\n", sysname, strerror(errno));
+		return -1;
+	}
+	if (policy->mempolicy != MPOL_DEFAULT
+		&& syscall(SYS_set_mempolicy, policy->mempolicy, &policy->nodes, NUMA_NODES + 1) == -1)
+	{
+		out_printf("-%s: numa: %s\n", sysname, strerror(errno));
+		return -1;
+	}
+	for (int resource = 0; resource < RLIM_NLIMITS; ++resource)
+	{
+		struct rlimit rl = { policy->limits[resource], policy->limits[resource] };
+		if (policy->has_limit[resource] && setrlimit(resource, &rl) == -1)
+		{
+			out_printf("-%s: limit: %s\n", sysname, strerror(errno));
+			return -1;
+		}
+	}
+	errno = 0;
+	if (policy->has_nice && nice(policy->nice) == -1 && errno != 0)
+	{
+		out_printf("-%s: nice: %s\n", sysname, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+/**
+ * Run a pin, numa, limit or nice prefix. With a command after the options
+ * they apply to that command only, on top of the session defaults; without
+ * one they become the session defaults. A bare prefix prints the defaults,
+ * so the builtin shadows a system nice: run it as, e.g., nice -n 5 nice.
+ * Prefixes can be chained; after a prefix, a prefix name with no command
+ * following its options is the system command of that name.
+ * @param  command [description]
+ * @return         [description]
+ */
+int process_policy(struct command_t *command)
+{
+	struct exec_policy_t policy = session_policy;
+	int used = parse_policy(command, &policy);
+	if (used == -1) return SUCCESS;
+	if (used == 0)
+	{
+		print_policy(&session_policy);
+		return SUCCESS;
+	}
+	if (used == command->arg_count)
+	{
+		session_policy = policy;
+		return SUCCESS;
+	}
 
-			normal = "\033[0m";
+	do // the rest of the arguments is the command to run
+	{
+		free(command->name);
+		for (int i = 0; i < used; ++i)
+			free(command->args[i]);
+		command->name = command->args[used];
+		command->arg_count -= used + 1;
+		memmove(command->args, command->args + used + 1, sizeof(char *) * command->arg_count);
 
-			while (fgets(line, sizeof(line), textfile) != NULL) {
+		used = 0;
+		if (is_policy_prefix(command->name)) // another prefix, if a command follows its options
+		{
+			struct exec_policy_t next = policy;
+			used = parse_policy(command, &next);
+			if (used == -1) return SUCCESS;
+			if (used == command->arg_count) used = 0; // run the system command instead
+			else policy = next;
+		}
+	} while (used > 0);
 
-				char buffer[sizeof(line)]; //used to print the modified string
+	// process_command looks for prefixes only while no policy is set
+	command->policy = &policy;
+	int code = process_command(command);
+	command->policy = NULL;
+	return code;
+}
+/**
+ * Schedule a command: it is appended in crontab format to sched.txt in the
+ * current directory, and the file is installed with crontab
+ * seashell> goodMorning <hour.minute> <command> [args]
+ * @param  command [description]
+ * @return         [description]
+ */
+int goodMorning(struct command_t *command)
+{
+	char current_direct[PATH_MAX];
+	char *nameof_txt = "sched.txt"; // name of txt file that will be opened at the current directory
+	struct capture_t toWrite = { 0 }; // the line in crontab syntax
+	char *hour = command->arg_count > 1 ? strtok(command->args[0], ".") : NULL; // tokenize hour
+	char *minute = hour ? strtok(NULL, " ") : NULL; // tokenize minute
+	if (minute == NULL)
+	{
+		out_printf("Usage: goodMorning <hour.minute> <command> [args]\n");
+		return SUCCESS;
+	}
+	if (getcwd(current_direct, sizeof(current_direct)) == NULL
+		|| strlen(current_direct) + strlen(nameof_txt) + 2 > sizeof(current_direct))
+	{
+		out_printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
+		return SUCCESS;
+	}
+	strcat(current_direct, "/");
+	strcat(current_direct, nameof_txt);
 
-				char* tokens = strtok(line, " ");//the text must have spacing between the punctuation marks for this to work correctly; otherwise it gets too complicated
+	int file_desc = open(current_direct, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644); // opens the file that stores the processes that will be scheduled
+	if (file_desc < 0)
+	{
+		out_printf("Error opening the file\n");
+		return SUCCESS;
+	}
 
-				char search_word[32]; //string ops work best with char arrays, so we're using those.
+	capture_append(&toWrite, minute, strlen(minute));
+	capture_append(&toWrite, " ", 1);
+	capture_append(&toWrite, hour, strlen(hour));
+	capture_append(&toWrite, " * * *", 6);
+	for (int j = 1; j < command->arg_count; ++j)
+	{
+		capture_append(&toWrite, " ", 1);
+		capture_append(&toWrite, command->args[j], strlen(command->args[j]));
+	}
+	capture_append(&toWrite, "\n", 1);
+	write(file_desc, toWrite.data, toWrite.len); // writes the process to be scheduled to txt file
+	close(file_desc);
+	free(toWrite.data);
 
-				strcpy(search_word, command->args[0]);
+	pid_t pid = fork();
+	if (pid == 0) {
+		char* argcron[3];
+		argcron[0] = "crontab";
+		argcron[1] = current_direct;
+		argcron[2] = NULL;
+
+		execvp(argcron[0], argcron); // executes crontab, command to set the alarm in crontab
+		_exit(1); // without flushing the output buffer copied from the shell
+	}
+	if (pid > 0)
+		waitpid(pid, NULL, 0);
+	return SUCCESS;
+}
+/**
+ * Short names for directories, kept in ~/Direct.txt as SHORT_NAME>EXACT_PATH
+ * lines. jump looks the short name up and changes to its path.
+ * seashell> shortdir <set | jump | delete> <name>, shortdir <list | clear>
+ * @param  command [description]
+ * @return         [description]
+ */
+int shortdir(struct command_t *command)
+{
+	char adress[PATH_MAX], interchange_adress[PATH_MAX];
+	char *homedir = getenv("HOME"); // the txt files are kept there
+	char *line, *split;
+	size_t len;
+	if (command->arg_count < 1 || homedir == NULL)
+	{
+		out_printf("Usage: shortdir <set | jump | delete> <name>, shortdir <list | clear>\n");
+		return SUCCESS;
+	}
+	snprintf(adress, sizeof(adress), "%s/Direct.txt", homedir); // file that stores the short names and related paths in the SHORT_NAME>EXACT_PATH format
+	snprintf(interchange_adress, sizeof(interchange_adress), "%s/Direct2.txt", homedir); // file that will be used for delete
 
-				bool valid = false; //tracks if we should be printing a line or not.
+	bool needs_name = strcmp(command->args[0], "set") == 0 || strcmp(command->args[0], "jump") == 0
+		|| strcmp(command->args[0], "delete") == 0;
+	if (needs_name && command->arg_count < 2)
+	{
+		out_printf("Usage: shortdir %s <name>\n", command->args[0]);
+		return SUCCESS;
+	}
 
-				int i;
+	if (strcmp(command->args[0], "set") == 0) {
+		char cwd[PATH_MAX];
+		FILE *f = fopen(adress, "a");
+		if (f == NULL)
+		{
+			out_printf("Error opening file!\n");
+			return SUCCESS;
+		}
+		if (getcwd(cwd, sizeof(cwd)) != NULL)
+			fprintf(f, "%s>%s\n", command->args[1], cwd);
+		fclose(f);
+	}
 
-				int search_length = strlen(search_word);
+	if (strcmp(command->args[0], "list") == 0) {
+		struct stream_t *file = stream_open(adress);
+		if (file != NULL) {
+			while (stream_fill(file) > 0) { // the file is already in SHORT_NAME>EXACT_PATH lines, copy it in blocks
+				out_write(file->buf, file->end);
+				file->start = file->end = 0;
+			}
+			stream_close(file);
+		}
+		else
+			out_printf("-%s: %s: %s: %s\n", sysname, command->name, adress, strerror(errno));
+	}
 
-				for (i = 0; tokens != NULL; i++) { //Searching for each token
-					
-					int k;
-					bool word_exists = true; //used for altering the token. If set to false during the if statement below, the word does not match
-					char token_word[32];
-					strcpy(token_word, tokens);
+	if (strcmp(command->args[0], "jump") == 0) { // idea is searching the SHORTNAME in the file line by line, the exact path is the rest of the line
+		struct stream_t *fp = stream_open(adress);
+		if (fp == NULL)
+		{
+			out_printf("-%s: %s: %s: %s\n", sysname, command->name, adress, strerror(errno));
+			return SUCCESS;
+		}
+		while ((line = stream_getline(fp, &len)) != NULL) {
+			split = strchr(line, '>');
+			if (split == NULL) continue;
+			*split = 0;
+			if (strcmp(command->args[1], line) == 0)
+				chdir(split + 1);
+		}
+		stream_close(fp);
+	}
 
-					if (strlen(tokens) != search_length) {//streamlines comparison process by checking lengths first, also prevents arrayIndexOutOfBounds
-						word_exists = false;
-					} else {
-						for (k = 0; k < search_length; k++) {
-							if (token_word[k] != search_word[k]) {//char by char comparison, case insensitive
-								if (token_word[k] + 32 != search_word[k]) {
-									word_exists = false;
-								}
-							}
-						}
-					}
+	if (strcmp(command->args[0], "delete") == 0) { // all the lines but the deleted ones are written into a new txt file, which then replaces the old one
+		struct stream_t *fp1 = stream_open(adress); // old file
+		if (fp1 == NULL)
+		{
+			out_printf("-%s: %s: %s: %s\n", sysname, command->name, adress, strerror(errno));
+			return SUCCESS;
+		}
+		FILE *fp2 = fopen(interchange_adress, "w");
+		if (fp2 == NULL)
+		{
+			out_printf("-%s: %s: %s: %s\n", sysname, command->name, interchange_adress, strerror(errno));
+			stream_close(fp1);
+			return SUCCESS;
+		}
+		while ((line = stream_getline(fp1, &len)) != NULL) {
+			split = strchr(line, '>');
+			size_t name_len = split ? (size_t)(split - line) : len;
+			if (strlen(command->args[1]) != name_len || strncmp(command->args[1], line, name_len) != 0)
+				fprintf(fp2, "%s\n", line);
+		}
+		stream_close(fp1);
+		fclose(fp2);
+		rename(interchange_adress, adress); // replaces the old file
+	}
 
-					if (word_exists) {//modifies the token and adds it to the buffer array. if it's false, token is added without modification.
+	if (strcmp(command->args[0], "clear") == 0) { // truncate the file so everything is cleared
+		int fd = open(adress, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd != -1)
+			close(fd);
+	}
+	return SUCCESS;
+}
+/**
+ * Run a command with its <, > and >> redirections applied. Builtins run
+ * in the shell itself, so the original descriptors are restored afterwards.
+ * @param  command [description]
+ * @return         return code of the command
+ */
+int process_redirects(struct command_t *command)
+{
+	char *redirects[3];
+	int saved[2] = { -1, -1 }, code = SUCCESS;
+	memcpy(redirects, command->redirects, sizeof(redirects));
+	out_flush();
+	fflush(stdout);
+	for (int i = 0; i < 3; ++i)
+	{
+		if (!redirects[i]) continue;
+		int target = i == 0 ? STDIN_FILENO : STDOUT_FILENO;
+		int flags = i == 0 ? O_RDONLY : O_WRONLY | O_CREAT | (i == 1 ? O_TRUNC : O_APPEND);
+		int fd = open(redirects[i], flags, 0644);
+		if (fd == -1)
+		{
+			out_printf("-%s: %s: %s\n", sysname, redirects[i], strerror(errno));
+			code = -1;
+			break;
+		}
+		if (saved[target] == -1)
+			saved[target] = fcntl(target, F_DUPFD_CLOEXEC, 0);
+		dup2(fd, target);
+		close(fd);
+	}
+	if (code == SUCCESS)
+	{
+		memset(command->redirects, 0, sizeof(command->redirects));
+		code = process_command(command);
+		memcpy(command->redirects, redirects, sizeof(redirects));
+	}
+	else
+		code = SUCCESS;
+	out_flush();
+	fflush(stdout);
+	for (int i = 0; i < 2; ++i)
+	{
+		if (saved[i] == -1) continue;
+		dup2(saved[i], i);
+		close(saved[i]);
+	}
+	return code;
+}
+/**
+ * Run a piped command: the left side runs in a child with its stdout on
+ * a pipe, the right side reads that pipe as its stdin. Builtins on the
+ * right side run in the shell itself, so stdin is restored afterwards.
+ * @param  command [description]
+ * @return         return code of the right side
+ */
+int process_pipeline(struct command_t *command)
+{
+	int fds[2], saved_stdin, code;
+	if (pipe(fds) == -1)
+	{
+		out_printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
+		return SUCCESS;
+	}
+	out_flush(); // do not let the child inherit pending output
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) // child
+	{
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[1]);
+		struct command_t *next = command->next;
+		command->next = NULL; // run only the left side here
+		process_command(command);
+		command->next = next;
+		exit(0);
+	}
+	close(fds[1]);
+	saved_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+	dup2(fds[0], STDIN_FILENO);
+	close(fds[0]);
+	code = process_command(command->next);
+	out_flush();
+	fflush(stdout);
+	dup2(saved_stdin, STDIN_FILENO);
+	close(saved_stdin);
+	waitpid(pid, NULL, 0);
+	return code;
+}
+#define CAPTURE_READSIZE (1 << 16) // free space kept for each read() of a capture
+/**
+ * Words the builtins may run in the shell itself when captured by $(...).
+ * Everything else, cd included, runs in a child with stdout on a pipe.
+ */
+bool is_capturable_builtin(const char *name)
+{
+	return strcmp(name, "highlight") == 0 || strcmp(name, "kdiff") == 0
+		|| strcmp(name, "shortdir") == 0;
+}
+/**
+ * Run a command line and collect what it writes to stdout
+ * @param  text    [description]
+ * @param  output  [description]
+ */
+void capture_command(const char *text, struct capture_t *output)
+{
+	struct substitutions_t subs = { 0 };
+	char *line = substitute_commands(text, &subs); // nested substitutions first
+	struct command_t *command = malloc(sizeof(struct command_t));
+	memset(command, 0, sizeof(struct command_t)); // set all bytes to 0
+	parse_substitutions = &subs;
+	parse_command(line, command);
+	parse_substitutions = NULL;
+	free_substitutions(&subs);
+	free(line);
+
+	if (!command->next && !command->redirects[0] && !command->redirects[1] && !command->redirects[2]
+		&& is_capturable_builtin(command->name))
+	{
+		struct capture_t *outer = out.capture;
+		out_flush(); // pending output is not part of the capture
+		out.capture = output;
+		process_command(command);
+		out_flush();
+		out.capture = outer;
+		dir_cache_clear(); // the command may have changed the directories globs read
+		free_command(command);
+		return;
+	}
 
-						char colored_word[64];
+	int fds[2];
+	if (pipe(fds) == -1)
+	{
+		out_printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
+		free_command(command);
+		return;
+	}
+	out_flush(); // do not let the child inherit pending output
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) // child
+	{
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[1]);
+		out.capture = NULL;
+		process_command(command);
+		exit(0);
+	}
+	close(fds[1]);
+	while (1)
+	{
+		if (output->size - output->len < CAPTURE_READSIZE)
+		{
+			output->size = output->size * 2 + CAPTURE_READSIZE;
+			output->data = realloc(output->data, output->size);
+		}
+		ssize_t n = read(fds[0], output->data + output->len, output->size - output->len);
+		if (n == -1 && errno == EINTR) continue;
+		if (n <= 0) break;
+		output->len += n;
+	}
+	close(fds[0]);
+	waitpid(pid, NULL, 0);
+	dir_cache_clear(); // the command may have changed the directories globs read
+	free_command(command);
+}
+/**
+ * Replace every $(...) and `...` in a command line with a marker, and
+ * collect what its command prints in subs, both as printed and split
+ * into words on whitespace.
+ * Text in single quotes is left alone.
+ * @param  buf     [description]
+ * @param  subs    [description]
+ * @return         the new line, to be freed by the caller
+ */
+char *substitute_commands(const char *buf, struct substitutions_t *subs)
+{
+	struct capture_t line = { 0 }, output;
+	bool quoted = false;
+	const char *p = buf;
+	char marker[32];
+	while (*p)
+	{
+		const char *start = NULL, *end = NULL;
+		if (*p == '\'')
+			quoted = !quoted;
+		else if (!quoted && p[0] == '$' && p[1] == '(')
+		{
+			int depth = 1;
+			start = p + 2;
+			for (end = start; *end; end++)
+			{
+				if (*end == '(') depth++;
+				else if (*end == ')' && --depth == 0) break;
+			}
+		}
+		else if (!quoted && *p == '`')
+		{
+			start = p + 1;
+			end = strchr(start, '`');
+		}
+		if (start == NULL || end == NULL || *end == 0) // plain character, or an unterminated substitution
+		{
+			capture_append(&line, p++, 1);
+			continue;
+		}
 
-						strcpy(colored_word, colorval);
+		char *text = strndup(start, end - start);
+		memset(&output, 0, sizeof(output));
+		capture_command(text, &output);
+		free(text);
 
-						strcat(colored_word, tokens);
-						strcat(colored_word, normal);
-						strcat(colored_word, " ");
-						strcat(buffer, colored_word);
+		subs->outputs = realloc(subs->outputs, sizeof(struct word_list_t) * (subs->count + 1));
+		struct word_list_t *words = &subs->outputs[subs->count];
+		memset(words, 0, sizeof(struct word_list_t));
+		for (size_t i = 0; i < output.len;) // split on whitespace
+		{
+			while (i < output.len && strchr(" \t\n", output.data[i])) i++;
+			size_t word = i;
+			while (i < output.len && !strchr(" \t\n", output.data[i])) i++;
+			if (i == word) break;
+			word_list_add(words, strndup(output.data + word, i - word));
+		}
+		subs->raw = realloc(subs->raw, sizeof(char *) * (subs->count + 1));
+		while (output.len > 0 && output.data[output.len - 1] == '\n') // trim newlines from the end
+			output.len--;
+		subs->raw[subs->count] = strndup(output.data ? output.data : "", output.len);
+		free(output.data);
+		snprintf(marker, sizeof(marker), "%c%zu%c", SUBST_MARK, subs->count++, SUBST_END);
+		capture_append(&line, marker, strlen(marker));
+		p = end + 1;
+	}
+	capture_append(&line, "", 1); // null terminate
+	return line.data;
+}
+int main()
+{
+	atexit(out_flush); // children started for pipes exit through here too
+	while (1)
+	{
+		struct command_t *command = malloc(sizeof(struct command_t));
+		memset(command, 0, sizeof(struct command_t)); // set all bytes to 0
 
-						valid = true;//flag that the searched word was found within a line.
+		while (waitpid(-1, NULL, WNOHANG) > 0); // reap finished background commands
 
-					}
-					else {
-						char token_buffer[32];
+		int code;
+		code = prompt(command);
+		if (code != EXIT)
+			code = process_command(command);
 
-						strcpy(token_buffer, tokens);
+		free_command(command);
+		if (code == EXIT) break;
+	}
 
-						strcat(token_buffer, " ");
-						strcat(buffer, token_buffer);
-					}
+	printf("\n");
+	return 0;
+}
 
-					tokens = strtok(NULL, " ");
-				}
+int process_command(struct command_t *command)
+{
+	int r;
+	if (strcmp(command->name, "") == 0) return SUCCESS;
 
-				if (valid) {//print the buffer onto the shell if a match was found.
-					printf("%s \n", buffer);
-				}
+	if (strcmp(command->name, "exit") == 0)
+		return EXIT;
 
-				memset(buffer, 0, sizeof(buffer)); //clear the buffer array for the next line.
+	if (command->next)
+		return process_pipeline(command);
 
-			}
+	if (command->redirects[0] || command->redirects[1] || command->redirects[2])
+		return process_redirects(command);
 
-			fclose(textfile);
+	if (strcmp(command->name, "cd") == 0)
+	{
+		if (command->arg_count > 0)
+		{
+			r = chdir(command->args[0]);
+			if (r == -1)
+				out_printf("-%s: %s: %s\n", sysname, command->name, strerror(errno));
 			return SUCCESS;
 		}
-		else {
-			printf("File could not be opened.");
-			return EXIT;
-		}
-
 	}
 
+	if (is_policy_prefix(command->name) && command->policy == NULL)
+		return process_policy(command);
+
+	if (strcmp(command->name, "highlight") == 0)
+		return highlight(command);
+
+	if (strcmp(command->name, "kdiff") == 0)
+		return kdiff(command);
+
+	if (strcmp(command->name, "goodMorning") == 0)
+		return goodMorning(command);
+
+	if (strcmp(command->name, "shortdir") == 0)
+		return shortdir(command);
+
+	out_flush(); // do not let the child inherit pending output
+	fflush(stdout);
 	pid_t pid = fork();
 	if (pid == 0) // child
 	{
+		if (apply_policy(command->policy ? command->policy : &session_policy) == -1)
+			exit(1); // do not run the command unconfined
+
 		/// This shows how to do exec with environ (but is not available on MacOs)
 		// extern char** environ; // environment variables
 		// execvpe(command->name, command->args, environ); // exec+args+path+environ
@@ -472,19 +2246,15 @@ int process_command(struct command_t *command)
 		command->args[command->arg_count - 1] = NULL;
 
 		char * PATH = getenv("PATH"); // return to PATH variable
-		char* token = strtok(PATH, ":"); // tokenize the PATH variable so that we can search in them for linux commands
-		char *new_path = malloc(8);
-		/* walk through other tokens */
+		char* token = PATH ? strtok(PATH, ":") : NULL; // tokenize the PATH variable so that we can search in them for linux commands
+		char new_path[PATH_MAX];
 
-		int i = 0;
 		/* walk through other tokens */
 		while (token != NULL) {    //searching at the path variable
-			new_path = realloc(new_path, strlen(token) + strlen(command->args[0]) + 2);
-			char* place = strdup(token);
-			strcpy(new_path, place);
-			strcat(new_path, "/");
-
-			strcat(new_path, command->args[0]);
+			if (snprintf(new_path, sizeof(new_path), "%s/%s", token, command->args[0]) >= sizeof(new_path)) {
+				token = strtok(NULL, ":");
+				continue;
+			}
 
 			if (access(new_path, X_OK) == 0) { // if linux command is found execute that command
 				execv(new_path, command->args);
@@ -499,307 +2269,11 @@ int process_command(struct command_t *command)
 	{
 
 		if (!command->background)
-			wait(0); // wait for child process to finish
-
-
-		if (strcmp(command->name, "kdiff") == 0) {  //implement kdiff
-			char* flag = strdup(command->args[0]);// this takes the parameter -a or -b
-			char* first_txt = strdup(command->args[1]); // name of first txt 
-			char* second_txt = strdup(command->args[2]);// name of second txt 
-			char* a = "./";
-			char* first_path = strdup(a);
-			char* second_path = strdup(a);
-			// these 4 lines are for finding first and second txt files relative to the current direcotry 
-			first_path = realloc(first_path, strlen(first_txt) + 3);
-			second_path = realloc(second_path, strlen(second_txt) + 3);
-			strcat(first_path, first_txt);
-			strcat(second_path, second_txt);
-			FILE * fp1; // first txt file
-			FILE* fp2; // second txt file
-			char* line1 = NULL;
-			char* line2 = NULL;
-			size_t len1 = 0;
-			ssize_t len2 = 0;
-			ssize_t read1;
-			ssize_t read2;
-			fp1 = fopen(first_path, "r");
-			fp2 = fopen(second_path, "r");
-
-			char* bitwise1 = malloc(8);
-			char* bitwise2 = malloc(8);
-			int bitcount = 0;
-
-			if (fp1 == NULL || fp2 == NULL) {
-				exit(EXIT_FAILURE);
-			}
-			int mismatch_counter = 0;  // counter for mismatches
-			int line_counter = 0;  // counts the lines
-			int no_difference = 0; // checks if the files are identical
-
-			if (strcmp(flag, "-a") == 0) {  // case we compare line by line
-				while ((read1 = getline(&line1, &len1, fp1)) != -1 && (read2 = getline(&line2, &len2, fp2)) != -1) {
-					line_counter++;
-					if (strcmp(line1, line2) != 0) {  // checks if the linesare identical if they are not counters updated lines are printed 
-						no_difference++;
-						mismatch_counter++;
-						printf("%s :Line %d: %s", first_txt, line_counter, line1);
-						printf("%s :Line %d: %s", second_txt, line_counter, line2);
-					}
-				}
-
-				if (read1 == -1 && (read2 = getline(&line2, &len2, fp2)) != -1) {  // case that first txt ends but not second txt. Printing extra lines
-				//read2 = getline(&line2, &len2 , fp2); // this line is nessecary because of the && in the while loop above. 
-					no_difference++;
-					line_counter++;
-					mismatch_counter++;
-					printf("%s :Line %d: %s", second_txt, line_counter, line2);
-					printf("%s :Line %d:is null \n", first_txt, line_counter);
-					while ((read2 = getline(&line2, &len2, fp2)) != -1) {
-						line_counter++;
-						mismatch_counter++;
-						printf("%s :Line %d: %s", second_txt, line_counter, line2);
-						printf("%s :Line %d:is null \n", first_txt, line_counter);
-					}
-				}
-				else if (read1 != -1 && read2 == -1) {  // case that second txt ends but not first txt. Printing extra lines
-					no_difference++;
-					line_counter++;
-					mismatch_counter++;
-					printf("%s :Line %d: %s", first_txt, line_counter, line1);
-					printf("%s :Line %d:is null  \n", second_txt, line_counter);
-					while ((read1 = getline(&line1, &len1, fp1)) != -1) {
-						line_counter++;
-						mismatch_counter++;
-
-						printf("%s :Line %d: %s", first_txt, line_counter, line1);
-						printf("%s :Line %d:is null  \n", second_txt, line_counter);
-					}
-				}
-				if (no_difference != 0) { // if the all lines are not identical print how many lines are different
-					printf("%d different line found \n", mismatch_counter);
-				}
-				else {
-					printf("All lines are identical \n");
-
-				}
-			}
-			else { // this part implements -b case which is bitwise comparison
-
-				int char1;
-				int char2;
-				int bitcntr = 0;
-				while ((char1 = fgetc(fp1)) != EOF && (char2 = fgetc(fp2)) != EOF) { // compares bit by bit 
-					if ((char)char1 != (char)char2)bitcntr++; 	// 1 char is  1 bit
-				}if (char1 == EOF) { //case when first txt file is finished
-					while ((char2 = fgetc(fp2)) != EOF) {
-						bitcntr++;
-					}
-				}if (char2 == EOF) { // case when second txt file is finished
-					while ((char1 = fgetc(fp1)) != EOF) {
-						bitcntr++;
-					}
-					if (bitcntr == 0) printf("Two files are identical \n ");
-					if (bitcntr != 0)printf("Files are different in  %d bytes \n", bitcntr);
-				}
-			}
-		}
-
-		if (strcmp(command->name, "goodMorning") == 0) { // command Good Morning / basic idea is storing the processes that will be scheduled in a txt file. In the txt file everything must be written in  crontab format
-			char* time = command->args[0];
-			char* hour = strdup(strtok(time, "."));// tokenize hour
-			char* minute = strdup(strtok(NULL, " ")); // tokenize minute
-			//printf("time:%s,minute:%s ", hour,minute );
-			FILE *fp = NULL;
-			char* nameof_txt = "sched.txt";// name of txt file that will be opened at the current directory
-			fp = fopen(nameof_txt, "a");
-			char* current_direct = malloc(PATH_MAX);
-			getcwd(current_direct, PATH_MAX);
-			current_direct = realloc(current_direct, strlen(current_direct) + 10);
-			strcat(current_direct, "/");
-			strcat(current_direct, nameof_txt);
-			int file_desc = open(current_direct, O_WRONLY | O_APPEND); // opens a schedule.txt file to store the processes that will be scheduled 
-
-			if (file_desc < 0)
-				printf("Error opening the file\n");
-
-			// dup() will create the copy of file_desc as the copy_desc 
-			// then both can be used interchangeably. 
-
-			int copy_desc = dup(file_desc);
-
-			// write() will write the given string into the file 
-			// referred by the file descriptors 
-			char* toWrite = strdup(minute); // toWrite is the string in the crontab syntax
-			toWrite = realloc(toWrite, strlen(toWrite) + strlen(time) + strlen(command->args[1]) + 10);
-			strcat(toWrite, " ");
-			strcat(toWrite, hour);
-			strcat(toWrite, " * * * ");
-			strcat(toWrite, command->args[1]);
-			int j = 2;
-			while (command->args[j] != NULL) {
-				toWrite = realloc(toWrite, strlen(toWrite) + strlen(command->args[j]) + 2);
-				strcat(toWrite, " ");
-				strcat(toWrite, command->args[j]);
-				j++;
-			}
-			strcat(toWrite, "\n");
-
-			write(copy_desc, toWrite, strlen(toWrite)); // writes the process to be scheduled to txt file which is created
-
-			pid_t pid = fork();
-			if (pid == 0) {
-
-				char* cmd = "crontab";
-				char* argcron[3];
-				argcron[0] = "crontab";
-				argcron[1] = current_direct;
-				argcron[2] = NULL;
-
-				execvp(cmd, argcron);// executes crontab,command to set the alarm in corontab 
-				exit(0);
-
-			}
-		}
-
-
-		if (strcmp(command->name, "shortdir") == 0) { // basic idea is storing all the related paths in the format SHORT_NAME>EXACT_PATH. These would be stored in a txt file. When we write the shortname and jump command then we will search for the SHORT_NAME and take the exact path from txt file.
-			char* cwd = malloc(PATH_MAX);
-			char* homedir = getenv("HOME");// returns to the HOME variable this program will create txt file there
-			char* adress = strdup(homedir);
-			adress = realloc(adress, strlen(adress) + 12);
-			strcat(adress, "/Direct.txt"); // file that stores the short names and related paths in the SHORT_NAME>EXACT_PATH format
-
-			char* interchange_adress = strdup(homedir);
-
-			interchange_adress = realloc(interchange_adress, strlen(interchange_adress) + 13);
-			strcat(interchange_adress, "/Direct2.txt");// file that will be used for clear and delete /stores the short names and related paths in the SHORT_NAME>EXACT_PATH format
-
-
-			if (strcmp(command->args[0], "set") == 0) {
-
+			waitpid(pid, NULL, 0); // wait for child process to finish
 
-				FILE *f = fopen(adress, "a");
-				if (f == NULL)
-				{
-					printf("Error opening file!\n");
-					exit(1);
-				}
-
-				/* print some text */
-				getcwd(cwd, PATH_MAX);
-				char* toWrite = strdup(command->args[1]);
-				toWrite = realloc(toWrite, strlen(toWrite) + strlen(cwd) + 2);
-				strcat(toWrite, ">");
-				strcat(toWrite, cwd);
-				strcat(toWrite, "\n");
-
-				fprintf(f, "%s", toWrite);
-
-				/* print integers and floats */
-
-
-				fclose(f);
-
-
-
-
-				//int file = open("/home/doruk/Documents/Direct.txt", O_WRONLY | O_APPEND); // file that stores the short names and related paths in the SHORT_NAME>EXACT_PATH format
-
-				  //  if(file < 0) 
-				  //      printf("Error opening the file\n"); 
-
-					// dup() will create the copy of file_desc as the copy_desc 
-				   // int copy = dup(file); 
-				 // char* toWrite = strdup(command->args[1]);
-				 // toWrite=realloc(toWrite, strlen(toWrite)+strlen(cwd)+2);
-				 //strcat(toWrite,">");
-				 // strcat(toWrite,cwd);
-				 // strcat(toWrite,"\n");
-				 // write(copy,toWrite, strlen(toWrite)); // write() will write the given string into the file in SHORT_NAME>EXACT_PATH format.
-
-
-			}
-
-
-			if (strcmp(command->args[0], "list") == 0) {
-				FILE * file;
-				file = fopen(adress, "r");
-				if (file != NULL) {
-					char line[512];
-					while (fgets(line, sizeof(line), file) != NULL) {
-						printf("%s", line);
-					}
-					fclose(file);
-				}
-				else {
-					printf("File could not be opened.");
-					return EXIT;
-				}
-
-
-			}
-
-			if (strcmp(command->args[0], "jump") == 0) { // idea is searching the SHORTNAME in the file line by line. Then tokenize the line and get the exact path
-				FILE * fp;
-				char * line = NULL;
-				size_t len = 0;
-				ssize_t read;
-
-				fp = fopen(adress, "r");
-				if (fp == NULL)
-					exit(EXIT_FAILURE);
-
-				while ((read = getline(&line, &len, fp)) != -1) {
-
-					char* token = strtok(line, ">");
-					// printf("token is -%s-,-%s- looking for", token,command->args[1]   );
-					if (strcmp(command->args[1], token) == 0) {
-						token = strtok(NULL, ">");
-
-						char* directory = malloc(strlen(token) - 1);
-						strncpy(directory, token, strlen(token) - 1);
-						strcat(directory, "/");
-						//   printf("token is %s----", directory);
-						chdir(directory);
-					}
-				}
-				fclose(fp);
-				if (line)
-					free(line);
-			}
-			if (strcmp(command->args[0], "delete") == 0) {// at delete idea is searching for the line which is going to be deleted(while searching, all the lines are written into new txt file that will be interchanged with the current txt file) than skipping that line(and keep going writing the other lines) and write all the other lines to the new txt file than change it name with old one
-				FILE * fp1;
-				FILE * fp2;
-				char * line = NULL;
-				size_t len = 0;
-				ssize_t read;
-				fp1 = fopen(adress, "r"); // old file
-				if (fp1 == NULL) exit(EXIT_FAILURE);
-
-				fp2 = fopen(interchange_adress, "w");
-
-				while ((read = getline(&line, &len, fp1)) != -1) { // write all the lines but not the lines that we want to delete to the new txt
-					char* clone = strdup(line);
-					char* token = strtok(line, ">");
-					//printf("token is %s", token);
-					if (strcmp(command->args[1], token) != 0) {
-						fprintf(fp2, clone);
-					}
-				}
-				fclose(fp1);
-				fclose(fp2);
-				remove(adress); // remove old one 
-				rename(interchange_adress, adress); // rename new txt file
-			}if (strcmp(command->args[0], "clear") == 0) { // remove and open new blank txt file so everything is cleared
-				remove(adress);
-				FILE* fp1;
-				fp1 = fopen(adress, "w");
-
-			}
-		}
 		return SUCCESS;
 
-		printf("-%s: %s: command not found\n", sysname, command->name);
+		out_printf("-%s: %s: command not found\n", sysname, command->name);
 		return UNKNOWN;
 	}
 }
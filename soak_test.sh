@@ -0,0 +1,112 @@
+#!/bin/bash
+# Soak test for long-running sessions: feeds a mix of builtins, globs,
+# substitutions, redirects, pipes and external commands to one seashell
+# and fails if its RSS or its number of open descriptors grows.
+#
+#   ./soak_test.sh [commands]          default 1000000
+#
+# Leak check under ASan/LSan (RSS is not checked, the ASan heap grows by design):
+#   SOAK_ASAN=1 ./soak_test.sh 20000
+# which builds with
+#   gcc -g -fsanitize=address,undefined -o seashell seashell_final.c
+set -e
+
+total=${1:-1000000}
+samples=20
+rss_slack_kb=512 # allowed RSS growth over the first sample
+
+src=$(cd "$(dirname "$0")" && pwd)/seashell_final.c
+work=$(mktemp -d)
+trap 'exec 3>&- 2>/dev/null; kill $pid 2>/dev/null; rm -rf "$work"' EXIT
+cd "$work"
+
+if [ -n "$SOAK_ASAN" ]; then
+	gcc -g -fsanitize=address,undefined -o seashell "$src"
+	export ASAN_OPTIONS=detect_leaks=1:exitcode=23
+else
+	gcc -O2 -o seashell "$src"
+fi
+
+printf 'hello ERROR world\nnothing here\nerror again\n' > log
+printf 'a\nb\nc\n' > f1
+printf 'a\nX\nc\nd\n' > f2
+touch a.txt b.txt c.log
+mkdir home
+export HOME=$work/home
+
+commands=(
+	'highlight error r log'
+	'kdiff -a f1 f2'
+	'kdiff -b f1 f2'
+	'shortdir set here'
+	'shortdir list'
+	'shortdir jump here'
+	'shortdir delete here'
+	'highlight error g log > out.txt'
+	'highlight error b < log >> out.txt'
+	'highlight error g log > out1.txt > out2.txt'
+	'kdiff -a f1 f1 > /dev/null'
+	'cd .'
+	'nice 1'
+	'nice off'
+	'pin'
+	'limit nofile=1024'
+	'limit off'
+	'highlight $(kdiff -a f1 f1) r log'
+	'highlight nope r missing.txt'
+)
+external=(
+	'echo *.txt {a,b}.log > /dev/null'
+	'cat log | highlight error r'
+	'echo $(echo a b) `echo c` > /dev/null'
+	'pin 0 true'
+)
+
+mkfifo in
+./seashell < in > /dev/null 2>&1 &
+pid=$!
+exec 3> in
+
+chunk=$((total / samples))
+baseline_rss= baseline_fds=
+for ((s = 1; s <= samples; s++)); do
+	awk -v start=$(((s - 1) * chunk)) -v n=$chunk -v nc=${#commands[@]} -v ne=${#external[@]} \
+		-v c="$(printf '%s\n' "${commands[@]}")" -v e="$(printf '%s\n' "${external[@]}")" '
+		BEGIN {
+			split(c, cmds, "\n"); split(e, ext, "\n")
+			for (i = start; i < start + n; i++)
+				print (i % 100 == 99) ? ext[int(i / 100) % ne + 1] : cmds[i % nc + 1]
+		}' >&3
+	# the shell is idle at its prompt once this file has been written
+	echo "highlight error r log > sync.$s" >&3
+	while [ ! -s sync.$s ]; do
+		kill -0 $pid 2>/dev/null || { echo "FAIL: seashell died"; exit 1; }
+		sleep 0.05
+	done
+
+	rss=$(awk '/^VmRSS/ { print $2 }' /proc/$pid/status)
+	fds=$(ls /proc/$pid/fd | wc -l)
+	echo "$((s * chunk)) commands: rss ${rss} kB, ${fds} fds"
+	if [ -z "$baseline_rss" ]; then
+		baseline_rss=$rss baseline_fds=$fds
+		continue
+	fi
+	if [ "$fds" -ne "$baseline_fds" ]; then
+		echo "FAIL: open descriptors went from $baseline_fds to $fds"
+		exit 1
+	fi
+	if [ -z "$SOAK_ASAN" ] && [ "$rss" -gt $((baseline_rss + rss_slack_kb)) ]; then
+		echo "FAIL: RSS grew from $baseline_rss kB to $rss kB"
+		exit 1
+	fi
+done
+
+echo exit >&3
+exec 3>&-
+code=0
+wait $pid || code=$?
+if [ "$code" -ne 0 ]; then
+	echo "FAIL: seashell exited with $code"
+	exit 1
+fi
+echo "OK: $total commands, rss ${baseline_rss}-${rss} kB, ${fds} fds"